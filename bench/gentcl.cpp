@@ -0,0 +1,362 @@
+// Synthetic Tcl workload generator for scaling tests
+//
+// Emits a runnable Tcl program of a chosen shape: procs in call-graph layers, loops,
+// variables, lists and dicts of a given size, spread over files that 'source' each other
+// as a tree, padded with extra procs up to a total line count (at most 1 GiB of source).
+// The output depends only on the seed and the parameters, down to the byte, so a
+// benchmark input can be named by its command line and rebuilt anywhere:
+//
+//   bench/gentcl --seed 7 --procs 2000 --depth 6 --files 64 --lines 5M --out /tmp/big
+//   ./tcl_debugger_tcl --script /tmp/big/main.tcl
+//
+// Every proc calls --calls procs of the next layer, so a run makes about
+// roots * calls^(depth-1) calls of --loops iterations each; padding procs are defined but
+// never called, so --lines grows what the loader and indexer see without growing the run.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstdint>
+#include <cctype>
+#include <cerrno>
+#include <algorithm>
+#include <filesystem>
+
+namespace {
+
+// splitmix64: unlike the standard distributions, the same on every library and platform
+class Random {
+private:
+    uint64_t state;
+
+public:
+    explicit Random(uint64_t seed) : state(seed) {}
+    
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+    
+    uint64_t below(uint64_t n) { return n ? next() % n : 0; }
+};
+
+struct Options {
+    uint64_t seed = 1;
+    size_t procs = 50;
+    size_t depth = 4;           // call-graph layers
+    size_t calls = 2;           // callees per proc in the next layer
+    size_t loops = 10;          // iterations of each proc's loop
+    size_t vars = 5;            // scalar variables per proc scope
+    size_t listSize = 10;
+    size_t dictSize = 10;
+    size_t files = 1;           // main.tcl plus files under lib/
+    size_t fanout = 4;          // files each file sources
+    uint64_t lines = 0;         // pad with uncalled procs up to this many lines
+    uint64_t maxBytes = 1ull << 30;
+    std::string output = "bench/generated";
+};
+
+const char* const words[] = {
+    "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+    "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+};
+
+// Counts what it writes and folds it into an FNV-1a fingerprint of the whole program
+class Writer {
+private:
+    std::ofstream out;
+    uint64_t& lines;
+    uint64_t& bytes;
+    uint64_t& hash;
+
+public:
+    Writer(const std::filesystem::path& path, bool append, uint64_t& lineCount, uint64_t& byteCount, uint64_t& fingerprint)
+        : out(path, append ? std::ios::app : std::ios::trunc), lines(lineCount), bytes(byteCount), hash(fingerprint) {}
+    
+    bool ok() const { return static_cast<bool>(out); }
+    
+    void line(const std::string& text) {
+        out << text << '\n';
+        lines++;
+        bytes += text.size() + 1;
+        for (char c : text) hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001b3ull;
+        hash = (hash ^ '\n') * 0x100000001b3ull;
+    }
+};
+
+class Generator {
+private:
+    const Options& options;
+    Random random;
+    std::vector<std::vector<size_t>> layers;       // proc ids per layer
+    std::vector<size_t> procLayer;
+    std::vector<std::vector<size_t>> callees;
+    std::vector<size_t> procFile;
+    uint64_t lineCount = 0;
+    uint64_t byteCount = 0;
+    uint64_t fingerprint = 0xcbf29ce484222325ull;
+    size_t fillerCount = 0;
+    
+    std::string procName(size_t id) const {
+        return "p" + std::to_string(procLayer[id]) + "_" + std::to_string(id);
+    }
+    
+    std::filesystem::path filePath(size_t file) const {
+        if (file == 0) return std::filesystem::path(options.output) / "main.tcl";
+        return std::filesystem::path(options.output) / "lib" / ("part" + std::to_string(file) + ".tcl");
+    }
+    
+    std::string word() { return words[random.below(sizeof(words) / sizeof(words[0]))]; }
+    
+    std::string listLiteral(size_t size) {
+        std::string list;
+        for (size_t i = 0; i < size; i++) {
+            if (i) list += ' ';
+            list += (i % 3 == 2) ? word() : std::to_string(random.below(100000));
+        }
+        return list;
+    }
+    
+    std::string dictLiteral(size_t size) {
+        std::string dict;
+        for (size_t i = 0; i < size; i++) {
+            if (i) dict += ' ';
+            dict += "k" + std::to_string(i) + " " + std::to_string(random.below(1000));
+        }
+        return dict;
+    }
+    
+    // Scalars of mixed types, a list and a dict, a loop that updates all of them, then
+    // the calls into the next layer
+    void writeProc(Writer& out, const std::string& name, const std::vector<size_t>& calls) {
+        out.line("proc " + name + " {depth seed} {");
+        for (size_t v = 0; v < options.vars; v++) {
+            switch (v % 3) {
+                case 0: out.line("    set v" + std::to_string(v) + " " + std::to_string(random.below(1000))); break;
+                case 1: out.line("    set v" + std::to_string(v) + " \"" + word() + " " + word() + "\""); break;
+                default: out.line("    set v" + std::to_string(v) + " [expr {$seed * " + std::to_string(random.below(97) + 1) + "}]"); break;
+            }
+        }
+        out.line("    set items [list " + listLiteral(options.listSize) + "]");
+        out.line("    set table [dict create " + dictLiteral(std::max<size_t>(options.dictSize, 1)) + "]");
+        out.line("    set total 0");
+        out.line("    for {set i 0} {$i < " + std::to_string(options.loops) + "} {incr i} {");
+        out.line("        incr total [expr {$i * $seed % 7}]");
+        out.line("        lset items [expr {$i % [llength $items]}] $i");
+        out.line("        dict incr table k[expr {$i % " + std::to_string(std::max<size_t>(options.dictSize, 1)) + "}]");
+        for (size_t v = 0; v < options.vars; v++) {
+            std::string var = "v" + std::to_string(v);
+            if (v % 3 == 1) out.line("        append " + var + " $i");
+            else out.line("        incr " + var);
+        }
+        out.line("    }");
+        for (size_t callee : calls) {
+            out.line("    incr total [" + procName(callee) + " [expr {$depth + 1}] [expr {($seed + $total) % 1000}]]");
+        }
+        out.line("    return [expr {($total + [llength $items] + [dict size $table]) % 1000003}]");
+        out.line("}");
+        out.line("");
+    }
+    
+    void writeSources(Writer& out, size_t file) {
+        for (size_t k = 1; k <= options.fanout; k++) {
+            size_t child = file * options.fanout + k;
+            if (child >= options.files) break;
+            std::string relative = file == 0 ? "lib part" + std::to_string(child) + ".tcl" : "part" + std::to_string(child) + ".tcl";
+            out.line("source [file join [file dirname [info script]] " + relative + "]");
+        }
+        out.line("");
+    }
+    
+    std::string header() const {
+        std::ostringstream text;
+        text << "# Generated by gentcl --seed " << options.seed << " --procs " << options.procs << " --depth " << options.depth
+             << " --calls " << options.calls << " --loops " << options.loops << " --vars " << options.vars
+             << " --list-size " << options.listSize << " --dict-size " << options.dictSize << " --files " << options.files
+             << " --fanout " << options.fanout << " --lines " << options.lines;
+        return text.str();
+    }
+
+public:
+    explicit Generator(const Options& opts) : options(opts), random(opts.seed) {
+        // Layers get procs in turn, so each has at least one and sizes differ by at most one
+        size_t depth = std::max<size_t>(1, std::min(options.depth, options.procs));
+        layers.resize(depth);
+        for (size_t id = 0; id < options.procs; id++) {
+            procLayer.push_back(id % depth);
+            layers[id % depth].push_back(id);
+        }
+        callees.resize(options.procs);
+        for (size_t id = 0; id < options.procs; id++) {
+            size_t next = procLayer[id] + 1;
+            if (next >= depth) continue;
+            for (size_t c = 0; c < options.calls; c++) {
+                callees[id].push_back(layers[next][random.below(layers[next].size())]);
+            }
+        }
+        for (size_t id = 0; id < options.procs; id++) procFile.push_back(random.below(options.files));
+    }
+    
+    bool generate() {
+        std::error_code error;
+        std::filesystem::path lib = std::filesystem::path(options.output) / "lib";
+        std::filesystem::create_directories(lib, error);
+        if (error) {
+            std::cerr << "[ERROR] Cannot create " << options.output << ": " << error.message() << std::endl;
+            return false;
+        }
+        // Parts left by an earlier run with more --files would be loaded with this one's
+        for (const auto& entry : std::filesystem::directory_iterator(lib, error)) {
+            std::string name = entry.path().filename().string();
+            if (name.size() > 8 && name.compare(0, 4, "part") == 0 && name.compare(name.size() - 4, 4, ".tcl") == 0 &&
+                name.find_first_not_of("0123456789", 4) == name.size() - 4) {
+                std::filesystem::remove(entry.path(), error);
+            }
+        }
+        
+        // Structure: each file's sources and its share of the call graph; main.tcl also
+        // calls every root and prints a checksum of the results
+        for (size_t file = 0; file < options.files; file++) {
+            Writer out(filePath(file), false, lineCount, byteCount, fingerprint);
+            if (!out.ok()) {
+                std::cerr << "[ERROR] Cannot write " << filePath(file).string() << std::endl;
+                return false;
+            }
+            out.line(header());
+            writeSources(out, file);
+            for (size_t id = 0; id < options.procs; id++) {
+                if (procFile[id] == file) writeProc(out, procName(id), callees[id]);
+            }
+            if (file == 0) {
+                out.line("set result 0");
+                for (size_t root : layers[0]) {
+                    out.line("set result [expr {($result + [" + procName(root) + " 0 " + std::to_string(random.below(1000)) + "]) % 1000003}]");
+                }
+                out.line("puts \"result: $result\"");
+            }
+        }
+        
+        // Padding: uncalled procs appended file by file until the line target or the byte cap
+        if (lineCount < options.lines) {
+            uint64_t perFile = (options.lines - lineCount) / options.files + 1;
+            for (size_t file = 0; file < options.files && lineCount < options.lines && byteCount < options.maxBytes; file++) {
+                Writer out(filePath(file), true, lineCount, byteCount, fingerprint);
+                uint64_t stop = std::min(options.lines, lineCount + perFile);
+                while (lineCount < stop && byteCount < options.maxBytes) {
+                    writeProc(out, "filler" + std::to_string(fillerCount++), {});
+                }
+            }
+            if (byteCount >= options.maxBytes && lineCount < options.lines) {
+                std::cerr << "[WARNING] Stopped at the " << options.maxBytes << " byte cap with " << lineCount << " lines" << std::endl;
+            }
+        }
+        return true;
+    }
+    
+    void summary() const {
+        std::cout << "Generated " << options.output << ": " << options.files << " files, " << options.procs << " procs in "
+                  << layers.size() << " layers, " << fillerCount << " padding procs, " << lineCount << " lines, "
+                  << byteCount << " bytes, fingerprint " << std::hex << std::setw(16) << std::setfill('0') << fingerprint
+                  << std::dec << std::endl;
+    }
+};
+
+// A whole decimal number, optionally with a k, m or g suffix: decimal for counts, binary
+// for byte sizes. Signs, fractions, other trailing text and overflow are rejected.
+bool parseSize(const std::string& text, bool binary, uint64_t& value, bool allowSuffix = true) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) return false;
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long number = std::strtoull(text.c_str(), &end, 10);
+    if (errno == ERANGE) return false;
+    uint64_t unit = 1;
+    std::string suffix(end);
+    if (!allowSuffix && !suffix.empty()) return false;
+    if (suffix == "k" || suffix == "K") unit = binary ? 1ull << 10 : 1000ull;
+    else if (suffix == "m" || suffix == "M") unit = binary ? 1ull << 20 : 1000000ull;
+    else if (suffix == "g" || suffix == "G") unit = binary ? 1ull << 30 : 1000000000ull;
+    else if (!suffix.empty()) return false;
+    if (number > UINT64_MAX / unit) return false;
+    value = number * unit;
+    return true;
+}
+
+void usage(const char* program) {
+    std::cout << "Usage: " << program << " [options]\n"
+              << "\n"
+              << "  --seed <n>           Random seed; same seed and options, same bytes (default 1)\n"
+              << "  --procs <n>          Procs in the call graph (default 50)\n"
+              << "  --depth <n>          Call-graph layers; layer k calls layer k+1 (default 4)\n"
+              << "  --calls <n>          Callees of each proc in the next layer (default 2)\n"
+              << "  --loops <n>          Loop iterations in each proc (default 10)\n"
+              << "  --vars <n>           Scalar variables per proc scope (default 5)\n"
+              << "  --list-size <n>      Elements of each proc's list (default 10)\n"
+              << "  --dict-size <n>      Keys of each proc's dict (default 10)\n"
+              << "  --files <n>          Files, main.tcl plus lib/part<i>.tcl (default 1)\n"
+              << "  --fanout <n>         Files each file sources (default 4)\n"
+              << "  --lines <n>[k|m|g]   Pad with uncalled procs up to this many lines\n"
+              << "  --max-bytes <n>[k|m|g]  Stop padding at this size (default and limit 1g)\n"
+              << "  --out <dir>          Output directory (default bench/generated)\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            usage(argv[0]);
+            return 0;
+        }
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string value = argv[++i];
+        uint64_t number = 0;
+        bool valid = true;
+        if (arg == "--out") {
+            options.output = value;
+        } else if (arg == "--lines") {
+            valid = parseSize(value, false, options.lines);
+        } else if (arg == "--seed") {
+            valid = parseSize(value, false, options.seed, false);
+        } else if (arg == "--max-bytes") {
+            valid = parseSize(value, true, number) && number > 0;
+            options.maxBytes = std::min<uint64_t>(number, 1ull << 30);
+        } else if (parseSize(value, false, number)) {
+            size_t count = static_cast<size_t>(number);
+            if (arg == "--procs") options.procs = std::max<size_t>(count, 1);
+            else if (arg == "--depth") options.depth = std::max<size_t>(count, 1);
+            else if (arg == "--calls") options.calls = count;
+            else if (arg == "--loops") options.loops = count;
+            else if (arg == "--vars") options.vars = count;
+            else if (arg == "--list-size") options.listSize = std::max<size_t>(count, 1);
+            else if (arg == "--dict-size") options.dictSize = std::max<size_t>(count, 1);
+            else if (arg == "--files") options.files = std::max<size_t>(count, 1);
+            else if (arg == "--fanout") options.fanout = std::max<size_t>(count, 1);
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            valid = false;
+        }
+        if (!valid) {
+            std::cerr << "[ERROR] Invalid value '" << value << "' for " << arg << std::endl;
+            return 1;
+        }
+    }
+    
+    Generator generator(options);
+    if (!generator.generate()) return 1;
+    generator.summary();
+    return 0;
+}
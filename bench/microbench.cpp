@@ -0,0 +1,424 @@
+// Microbenchmarks for the debugger's own hot paths
+//
+// Builds tcl_debugger.cpp into the same translation unit (without its main) so the
+// benchmarks reach the classes directly. Each case is timed in batches until it has run
+// for the target time, best of three, and every operator new in the timed region is
+// counted. Results go to a JSON file meant to be diffed between versions:
+//
+//   make -f Makefile.unix bench                     # writes bench/results.json
+//   bench/microbench --out old.json --time 500 --filter tracker/
+
+#define TCLDBG_NO_MAIN
+#include "../tcl_debugger.cpp"
+
+// The counting operator new/delete below pair malloc with free; GCC cannot see that
+// through the inlined standard library and warns at every delete
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+#include <new>
+
+// Allocation counting for the whole process; the benchmarks run on the main thread
+// and the execution thread is idle while they are timed
+static std::atomic<uint64_t> allocationCount{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { std::free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { std::free(p); }
+
+namespace {
+
+// Keeps a result alive so the optimizer cannot drop the work that produced it
+template <typename T>
+void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+// Swallows std::cout while a case runs; the debugger prints as it tracks
+struct DiscardBuffer : std::streambuf {
+    char sink[4096];
+    int overflow(int c) override {
+        setp(sink, sink + sizeof(sink));
+        return traits_type::not_eof(c);
+    }
+};
+
+struct Result {
+    std::string name;
+    double nsPerOp;
+    double allocsPerOp;
+    uint64_t iterations;
+};
+
+// A case runs at least n operations and returns how many it ran; cases that work in
+// fixed batches (a command stream, a set of names) may run more
+using Body = std::function<uint64_t(uint64_t)>;
+
+class Bench {
+private:
+    std::vector<Result> results;
+    std::string filter;
+    double targetMillis;
+    DiscardBuffer discard;
+    
+    struct Sample {
+        double nanos;
+        uint64_t allocations;
+        uint64_t ops;
+    };
+    
+    Sample sample(const Body& body, uint64_t n) {
+        std::streambuf* console = std::cout.rdbuf(&discard);
+        uint64_t allocationsBefore = allocationCount.load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t ops = body(n);
+        auto end = std::chrono::steady_clock::now();
+        uint64_t allocations = allocationCount.load(std::memory_order_relaxed) - allocationsBefore;
+        std::cout.rdbuf(console);
+        return {std::chrono::duration<double, std::nano>(end - start).count(), allocations, std::max<uint64_t>(ops, 1)};
+    }
+
+public:
+    Bench(std::string filterText, double millis) : filter(std::move(filterText)), targetMillis(millis) {}
+    
+    void run(const std::string& name, const Body& body) {
+        if (!filter.empty() && name.find(filter) == std::string::npos) return;
+        
+        // Grow the batch until one takes a tenth of the target, then size it to the target
+        Sample probe = sample(body, 1);
+        while (probe.nanos < targetMillis * 1e5 && probe.ops < (1ull << 40)) {
+            uint64_t growth = probe.nanos > 0 ? static_cast<uint64_t>(targetMillis * 1e5 / probe.nanos) + 1 : 100;
+            probe = sample(body, probe.ops * std::clamp<uint64_t>(growth, 2, 100));
+        }
+        uint64_t n = std::max<uint64_t>(1, static_cast<uint64_t>(probe.ops * (targetMillis * 1e6 / std::max(probe.nanos, 1.0))));
+        
+        Result best{name, 0, 0, 0};
+        for (int rep = 0; rep < 3; rep++) {
+            Sample s = sample(body, n);
+            double nsPerOp = s.nanos / s.ops;
+            if (rep == 0 || nsPerOp < best.nsPerOp) {
+                best.nsPerOp = nsPerOp;
+                best.allocsPerOp = static_cast<double>(s.allocations) / s.ops;
+                best.iterations = s.ops;
+            }
+        }
+        
+        std::cout << Format::padRight(name, 36) << " " << std::setw(12) << std::fixed << std::setprecision(1)
+                  << best.nsPerOp << " ns/op " << std::setw(9) << std::setprecision(2) << best.allocsPerOp
+                  << " allocs/op " << std::setw(11) << best.iterations << " ops" << std::endl;
+        results.push_back(best);
+    }
+    
+    bool save(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) return false;
+        out << "{\n  \"version\": 1,\n  \"target_ms\": " << targetMillis << ",\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            out << "    {\"name\": \"" << r.name << "\", \"ns_per_op\": " << std::fixed << std::setprecision(2) << r.nsPerOp
+                << ", \"allocs_per_op\": " << std::setprecision(3) << r.allocsPerOp
+                << ", \"iterations\": " << r.iterations << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+};
+
+std::string makeList(size_t count, const std::string& prefix) {
+    std::string list;
+    for (size_t i = 0; i < count; i++) {
+        if (i) list += ' ';
+        list += prefix + std::to_string(i);
+    }
+    return list;
+}
+
+std::string makeDict(size_t count, size_t changed = SIZE_MAX) {
+    std::string dict;
+    for (size_t i = 0; i < count; i++) {
+        if (i) dict += ' ';
+        dict += "key" + std::to_string(i) + " " + (i == changed ? "changed" : "value" + std::to_string(i));
+    }
+    return dict;
+}
+
+void variableInfoCases(Bench& bench) {
+    const std::string integer = "42";
+    const std::string text = "The quick brown fox jumps over the lazy dog";
+    const std::string list = "{" + makeList(8, "item") + "}";
+    const std::string dict = "{" + makeDict(6) + "}";
+    
+    auto construct = [](const std::string& value) {
+        return [value](uint64_t n) {
+            for (uint64_t i = 0; i < n; i++) {
+                EnhancedVariableInfo info("counter", value);
+                keep(info);
+            }
+            return n;
+        };
+    };
+    bench.run("variable_info/construct_int", construct(integer));
+    bench.run("variable_info/construct_string", construct(text));
+    bench.run("variable_info/construct_list8", construct(list));
+    bench.run("variable_info/construct_dict6", construct(dict));
+    
+    auto update = [](const std::string& a, const std::string& b) {
+        return [a, b](uint64_t n) {
+            EnhancedVariableInfo info("counter", a);
+            for (uint64_t i = 0; i < n; i++) {
+                info.updateValue((i & 1) ? a : b, static_cast<int>(i));
+            }
+            keep(info);
+            return n;
+        };
+    };
+    bench.run("variable_info/update_int", update("42", "43"));
+    bench.run("variable_info/update_list8", update(list, "{" + makeList(8, "other") + "}"));
+    bench.run("variable_info/update_dict6", update(dict, "{" + makeDict(6, 3) + "}"));
+}
+
+void parseCases(Bench& bench) {
+    const std::string list = makeList(100, "element");
+    const std::string nested = "{" + makeList(10, "a") + "} {" + makeList(10, "b") + "} \"quoted words\" tail";
+    const std::string before = makeDict(50);
+    const std::string after = makeDict(50, 25);
+    
+    bench.run("parse/split_list100", [&list](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) keep(ValueDiff::splitElements(list));
+        return n;
+    });
+    bench.run("parse/split_nested", [&nested](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) keep(ValueDiff::splitElements(nested));
+        return n;
+    });
+    bench.run("parse/diff_dict50", [&before, &after](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) keep(ValueDiff::diffValues(before, after, true));
+        return n;
+    });
+    bench.run("parse/diff_list100", [&list](uint64_t n) {
+        std::string changed = list;
+        changed.replace(changed.find("element50"), 9, "replaced");
+        for (uint64_t i = 0; i < n; i++) keep(ValueDiff::diffValues(list, changed, false));
+        return n;
+    });
+}
+
+void trackerCases(Bench& bench) {
+    // A new tracker every 4096 names keeps the map at a realistic size
+    std::vector<std::string> names;
+    for (int i = 0; i < 4096; i++) names.push_back("var" + std::to_string(i));
+    
+    bench.run("tracker/create", [&names](uint64_t n) {
+        uint64_t ops = 0;
+        while (ops < n) {
+            MemoryAwareVariableTracker tracker;
+            tracker.setTracing(false);
+            for (const auto& name : names) tracker.addVariable(name, "1", "global", 1);
+            ops += names.size();
+        }
+        return ops;
+    });
+    
+    auto update = [](bool monitoring) {
+        return [monitoring](uint64_t n) {
+            MemoryAwareVariableTracker tracker;
+            tracker.enableRealTimeMonitoring(monitoring);
+            tracker.setTracing(monitoring);
+            std::string values[2] = {"100", "101"};
+            for (uint64_t i = 0; i < n; i++) {
+                tracker.addVariable("counter", values[i & 1], "global", static_cast<int>(i & 1023));
+            }
+            return n;
+        };
+    };
+    bench.run("tracker/update_unmonitored", update(false));
+    bench.run("tracker/update_monitored", update(true));
+    
+    bench.run("tracker/update_list_monitored", [](uint64_t n) {
+        MemoryAwareVariableTracker tracker;
+        tracker.enableRealTimeMonitoring(true);
+        std::string values[2] = {"{" + makeList(40, "x") + "}", "{" + makeList(40, "y") + "}"};
+        for (uint64_t i = 0; i < n; i++) tracker.addVariable("items", values[i & 1], "global", 1);
+        return n;
+    });
+}
+
+void breakpointCases(Bench& bench) {
+    std::streambuf* console = std::cout.rdbuf(nullptr);
+    auto manager = std::make_shared<EnhancedBreakpointManager>();
+    for (int line = 1; line <= 200; line += 2) manager->addBreakpoint(line, "/project/app.tcl");
+    for (int line = 1; line <= 50; line++) manager->addBreakpoint(line, "/project/lib/util.tcl");
+    for (int i = 0; i < 10; i++) manager->addVariableWatchBreakpoint(10000 + i, "watched" + std::to_string(i), i % 2 ? "changed" : "");
+    std::cout.rdbuf(console);
+    const std::string file = "/project/app.tcl";
+    
+    bench.run("breakpoints/lookup_hit", [manager, &file](uint64_t n) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < n; i++) hits += manager->hasBreakpoint(file, static_cast<int>((i % 100) * 2 + 1));
+        keep(hits);
+        return n;
+    });
+    bench.run("breakpoints/lookup_miss", [manager, &file](uint64_t n) {
+        uint64_t hits = 0;
+        for (uint64_t i = 0; i < n; i++) hits += manager->hasBreakpoint(file, static_cast<int>((i % 100) * 2 + 2));
+        keep(hits);
+        return n;
+    });
+    
+    // Every tracked write goes through the change callback to the watch breakpoints,
+    // as the console wires it
+    bench.run("breakpoints/watch_dispatch", [manager](uint64_t n) {
+        MemoryAwareVariableTracker tracker;
+        tracker.setTracing(false);
+        uint64_t triggered = 0;
+        tracker.setVariableChangeCallback([&](const std::string& name, const std::string& oldValue, const std::string& newValue) {
+            triggered += manager->checkVariableWatchBreakpoint(name, oldValue, newValue);
+        });
+        std::string values[2] = {"1", "2"};
+        for (uint64_t i = 0; i < n; i++) tracker.addVariable((i & 1) ? "watched3" : "plain", values[(i >> 1) & 1]);
+        keep(triggered);
+        return n;
+    });
+}
+
+void consoleCases(Bench& bench) {
+    // Commands that only change settings, so each line is dispatch plus a short reply
+    const char* commands[] = {"timeout 30", "limit commands 1000000", "timeout off", "limit off", "instrument line"};
+    const uint64_t batch = 5000;
+    std::string stream, prefixed;
+    for (uint64_t i = 0; i < batch; i++) {
+        stream += std::string(commands[i % 5]) + "\n";
+        prefixed += (i & 1) ? "time 30\n" : "lim off\n";
+    }
+    
+    auto dispatch = [batch](const std::string& lines) {
+        return [lines, batch](uint64_t n) {
+            DebugConsole console;
+            console.setQuiet(true);
+            uint64_t ops = 0;
+            while (ops < n) {
+                std::istringstream input(lines);
+                console.start(input, false);
+                ops += batch;
+            }
+            return ops;
+        };
+    };
+    bench.run("console/dispatch", dispatch(stream));
+    bench.run("console/dispatch_prefix", dispatch(prefixed));
+}
+
+void loadCases(Bench& bench, const std::filesystem::path& directory) {
+    // A generated script of procs, loops and data; one op is one line loaded
+    std::filesystem::path path = directory / "tcldbg_bench_source.tcl";
+    const int procs = 400;
+    int lines = 0;
+    {
+        std::ofstream out(path);
+        for (int p = 0; p < procs; p++) {
+            out << "proc worker" << p << " {count} {\n"
+                << "    set total 0\n"
+                << "    for {set i 0} {$i < $count} {incr i} {\n"
+                << "        set total [expr {$total + $i * " << p << "}]\n"
+                << "        lappend items \"item$i\"\n"
+                << "    }\n"
+                << "    dict set state worker" << p << " $total\n"
+                << "    return $total\n"
+                << "}\n";
+            lines += 9;
+        }
+        for (int p = 0; p < procs; p++) {
+            out << "puts [worker" << p << " " << (p % 10 + 1) << "]\n";
+            lines++;
+        }
+    }
+    
+    auto load = [path, lines](bool cached) {
+        return [path, lines, cached](uint64_t n) {
+            uint64_t ops = 0;
+            ScriptExecutionController controller;
+            controller.setIndexCache(cached);
+            controller.setTracing(false);
+            while (ops < n) {
+                controller.loadScript(path.string());
+                ops += static_cast<uint64_t>(lines);
+            }
+            return ops;
+        };
+    };
+    bench.run("load/source_per_line", load(false));
+    bench.run("load/source_per_line_cached", load(true));
+    
+    std::error_code ignored;
+    std::filesystem::remove(path, ignored);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string output = "bench/results.json";
+    std::string filter;
+    double millis = 200;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--out" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--time" && i + 1 < argc) {
+            millis = std::max(1.0, std::atof(argv[++i]));
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--out <file>] [--filter <text>] [--time <ms per case>]" << std::endl;
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    
+    Colors::disable();
+    Bench bench(filter, millis);
+    variableInfoCases(bench);
+    parseCases(bench);
+    trackerCases(bench);
+    breakpointCases(bench);
+    consoleCases(bench);
+    std::error_code ignored;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(ignored);
+    loadCases(bench, ignored ? std::filesystem::path(".") : directory);
+    
+    if (!bench.save(output)) {
+        std::cerr << "[ERROR] Cannot write " << output << std::endl;
+        return 1;
+    }
+    std::cout << "Results written to " << output << std::endl;
+    return 0;
+}
@@ -0,0 +1,348 @@
+// End-to-end overhead of the debugger: runs each Tcl workload in a plain tclsh and under
+// the real-interpreter debugger at each instrumentation level, and reports wall time, CPU
+// time, peak RSS and the slowdown over tclsh. Unix only (fork/exec and wait4).
+//
+//   make -f Makefile.unix overhead                  # writes bench/overhead.json
+//   bench/overhead --modes native,off,line --runs 5 bench/workloads/loops.tcl
+//   bench/overhead --baseline old.json --threshold 20   # exit 1 on a regression
+//
+// Slowdowns are compared rather than times, so a baseline from another machine still
+// gives a meaningful comparison.
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <regex>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+namespace {
+
+struct Measurement {
+    std::string workload;
+    std::string mode;
+    std::string status;         // ok, failed or timeout
+    double wallMillis = 0;
+    double cpuMillis = 0;
+    long peakRssKb = 0;
+    double slowdown = 0;        // wall time over native (or the first mode), 0 when unknown
+};
+
+struct Options {
+    std::string debugger = "./tcl_debugger_tcl";
+    std::string tclsh = "tclsh";
+    std::vector<std::string> modes = {"native", "off", "proc", "command", "line", "var"};
+    std::vector<std::string> workloads;
+    std::string output = "bench/overhead.json";
+    std::string baseline;
+    std::string scale = "1";
+    double threshold = 25;                      // percent over the baseline slowdown
+    std::map<std::string, double> maxSlowdown;  // mode -> absolute cap
+    int runs = 3;
+    int timeoutSeconds = 120;
+};
+
+std::vector<std::string> split(const std::string& text, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream stream(text);
+    std::string part;
+    while (std::getline(stream, part, separator)) {
+        if (!part.empty()) parts.push_back(part);
+    }
+    return parts;
+}
+
+// One run with stdout and stderr discarded; the watchdog kills it after the timeout
+Measurement runOnce(const std::vector<std::string>& argv, const Options& options) {
+    Measurement m;
+    std::vector<char*> args;
+    for (const auto& arg : argv) args.push_back(const_cast<char*>(arg.c_str()));
+    args.push_back(nullptr);
+    
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        m.status = "failed";
+        return m;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        if (null >= 0) {
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+        }
+        setenv("TCLDBG_BENCH_SCALE", options.scale.c_str(), 1);
+        execvp(args[0], args.data());
+        _exit(127);
+    }
+    
+    std::mutex mutex;
+    std::condition_variable finished;
+    bool done = false, killed = false;
+    std::thread watchdog([&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!finished.wait_for(lock, std::chrono::seconds(options.timeoutSeconds), [&]() { return done; })) {
+            killed = true;
+            kill(pid, SIGKILL);
+        }
+    });
+    
+    int status = 0;
+    struct rusage usage {};
+    while (wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+    auto end = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    finished.notify_one();
+    watchdog.join();
+    
+    m.wallMillis = std::chrono::duration<double, std::milli>(end - start).count();
+    m.cpuMillis = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+#ifdef __APPLE__
+    m.peakRssKb = usage.ru_maxrss / 1024;   // bytes on macOS
+#else
+    m.peakRssKb = usage.ru_maxrss;
+#endif
+    if (killed) m.status = "timeout";
+    else m.status = (WIFEXITED(status) && WEXITSTATUS(status) == 0) ? "ok" : "failed";
+    return m;
+}
+
+// Best wall time of the runs; a failed or timed-out run ends the series
+Measurement measure(const std::string& workload, const std::string& mode, const std::string& commandFile, const Options& options) {
+    std::vector<std::string> argv;
+    if (mode == "native") {
+        argv = {options.tclsh, workload};
+    } else {
+        argv = {options.debugger, "--script", workload, "--commands", commandFile, "--quiet", "--no-color", "--instrument", mode};
+    }
+    
+    Measurement best;
+    for (int run = 0; run < options.runs; run++) {
+        Measurement m = runOnce(argv, options);
+        if (m.status != "ok") {
+            best = m;
+            break;
+        }
+        if (run == 0 || m.wallMillis < best.wallMillis) best = m;
+    }
+    best.workload = workload;
+    best.mode = mode;
+    return best;
+}
+
+std::string escape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out;
+}
+
+bool save(const std::string& path, const std::vector<Measurement>& results, const Options& options) {
+    std::ofstream out(path);
+    if (!out) return false;
+    out << "{\n  \"version\": 1,\n  \"scale\": " << options.scale << ",\n  \"runs\": " << options.runs << ",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const Measurement& m = results[i];
+        out << "    {\"workload\": \"" << escape(m.workload) << "\", \"mode\": \"" << m.mode << "\", \"status\": \"" << m.status
+            << "\", \"wall_ms\": " << std::fixed << std::setprecision(2) << m.wallMillis
+            << ", \"cpu_ms\": " << m.cpuMillis << ", \"peak_rss_kb\": " << m.peakRssKb
+            << ", \"slowdown\": " << std::setprecision(3) << m.slowdown << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return static_cast<bool>(out);
+}
+
+// Reads back what save() writes: one result object per line
+std::map<std::pair<std::string, std::string>, Measurement> loadBaseline(const std::string& path) {
+    std::map<std::pair<std::string, std::string>, Measurement> baseline;
+    std::ifstream in(path);
+    std::regex entry("\"workload\": \"((?:[^\"\\\\]|\\\\.)*)\", \"mode\": \"([^\"]*)\", \"status\": \"([^\"]*)\".*\"slowdown\": ([0-9.eE+-]+)");
+    std::string line;
+    while (std::getline(in, line)) {
+        std::smatch match;
+        if (!std::regex_search(line, match, entry)) continue;
+        Measurement m;
+        m.workload = std::regex_replace(match[1].str(), std::regex("\\\\(.)"), "$1");
+        m.mode = match[2];
+        m.status = match[3];
+        m.slowdown = std::atof(match[4].str().c_str());
+        baseline[{m.workload, m.mode}] = m;
+    }
+    return baseline;
+}
+
+void printRow(const Measurement& m) {
+    std::cout << std::left << std::setw(32) << std::filesystem::path(m.workload).filename().string()
+              << std::setw(9) << m.mode << std::right;
+    if (m.status != "ok") {
+        std::cout << "  " << m.status << " after " << std::fixed << std::setprecision(0) << m.wallMillis << " ms" << std::endl;
+        return;
+    }
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(11) << m.wallMillis << std::setw(11) << m.cpuMillis
+              << std::setw(10) << std::setprecision(1) << m.peakRssKb / 1024.0;
+    if (m.slowdown > 0) std::cout << std::setw(9) << std::setprecision(2) << m.slowdown << "x";
+    std::cout << std::endl;
+}
+
+void usage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [workload.tcl...]\n"
+              << "\n"
+              << "  --debugger <path>        Real-interpreter debugger (default ./tcl_debugger_tcl)\n"
+              << "  --tclsh <path>           Native interpreter (default tclsh)\n"
+              << "  --modes <list>           Comma-separated: native, off, proc, command, line, var (default all)\n"
+              << "  --runs <n>               Runs per workload and mode, best wall time kept (default 3)\n"
+              << "  --scale <x>              Workload size factor, passed as TCLDBG_BENCH_SCALE (default 1)\n"
+              << "  --timeout <secs>         Kill a run after this long (default 120)\n"
+              << "  --out <file>             JSON results (default bench/overhead.json)\n"
+              << "  --baseline <file>        Earlier results to compare slowdowns against\n"
+              << "  --threshold <percent>    Allowed slowdown growth over the baseline (default 25)\n"
+              << "  --max-slowdown <mode=x>  Fail when any workload runs more than x times slower in mode\n"
+              << "\n"
+              << "Without workloads, runs test_memory_debug.tcl and bench/workloads/*.tcl.\n"
+              << "Exit status is 1 when a run fails, a slowdown cap is exceeded or a slowdown\n"
+              << "regressed past the threshold.\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--debugger" && hasValue) {
+            options.debugger = argv[++i];
+        } else if (arg == "--tclsh" && hasValue) {
+            options.tclsh = argv[++i];
+        } else if (arg == "--modes" && hasValue) {
+            options.modes = split(argv[++i], ',');
+        } else if (arg == "--runs" && hasValue) {
+            options.runs = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--scale" && hasValue) {
+            options.scale = argv[++i];
+        } else if (arg == "--timeout" && hasValue) {
+            options.timeoutSeconds = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--out" && hasValue) {
+            options.output = argv[++i];
+        } else if (arg == "--baseline" && hasValue) {
+            options.baseline = argv[++i];
+        } else if (arg == "--threshold" && hasValue) {
+            options.threshold = std::atof(argv[++i]);
+        } else if (arg == "--max-slowdown" && hasValue) {
+            std::string cap = argv[++i];
+            size_t equals = cap.find('=');
+            if (equals == std::string::npos) {
+                std::cerr << "[ERROR] --max-slowdown expects mode=factor, got '" << cap << "'" << std::endl;
+                return 1;
+            }
+            options.maxSlowdown[cap.substr(0, equals)] = std::atof(cap.c_str() + equals + 1);
+        } else if (arg == "--help" || (!arg.empty() && arg[0] == '-')) {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 1;
+        } else {
+            options.workloads.push_back(arg);
+        }
+    }
+    for (const auto& mode : options.modes) {
+        static const std::vector<std::string> known = {"native", "off", "proc", "command", "line", "var"};
+        if (std::find(known.begin(), known.end(), mode) == known.end()) {
+            std::cerr << "[ERROR] Unknown mode '" << mode << "'" << std::endl;
+            return 1;
+        }
+    }
+    if (options.workloads.empty()) {
+        options.workloads.push_back("test_memory_debug.tcl");
+        std::vector<std::string> synthetic;
+        std::error_code ignored;
+        for (const auto& entry : std::filesystem::directory_iterator("bench/workloads", ignored)) {
+            if (entry.path().extension() == ".tcl") synthetic.push_back(entry.path().string());
+        }
+        std::sort(synthetic.begin(), synthetic.end());
+        options.workloads.insert(options.workloads.end(), synthetic.begin(), synthetic.end());
+    }
+    
+    // The debugger reads its commands from a file: run the script, then exit
+    std::filesystem::path commandFile = std::filesystem::temp_directory_path() / ("tcldbg_overhead_" + std::to_string(getpid()) + ".cmds");
+    std::ofstream(commandFile) << "run\n";
+    
+    std::cout << std::left << std::setw(32) << "workload" << std::setw(9) << "mode" << std::right
+              << std::setw(11) << "wall ms" << std::setw(11) << "cpu ms" << std::setw(10) << "rss MB" << std::setw(10) << "slowdown" << std::endl;
+    std::vector<Measurement> results;
+    for (const auto& workload : options.workloads) {
+        double reference = 0;
+        for (const auto& mode : options.modes) {
+            Measurement m = measure(workload, mode, commandFile.string(), options);
+            if (m.status == "ok") {
+                if (reference == 0) reference = m.wallMillis;
+                m.slowdown = m.wallMillis / reference;
+            }
+            printRow(m);
+            results.push_back(m);
+        }
+    }
+    std::filesystem::remove(commandFile);
+    
+    if (!save(options.output, results, options)) {
+        std::cerr << "[ERROR] Cannot write " << options.output << std::endl;
+        return 1;
+    }
+    std::cout << "Results written to " << options.output << std::endl;
+    
+    int problems = 0;
+    for (const auto& m : results) {
+        if (m.status != "ok") {
+            std::cout << "[FAIL] " << m.workload << " (" << m.mode << "): " << m.status << std::endl;
+            problems++;
+            continue;
+        }
+        auto cap = options.maxSlowdown.find(m.mode);
+        if (cap != options.maxSlowdown.end() && m.slowdown > cap->second) {
+            std::cout << "[FAIL] " << m.workload << " (" << m.mode << "): " << std::fixed << std::setprecision(2)
+                      << m.slowdown << "x exceeds the " << cap->second << "x cap" << std::endl;
+            problems++;
+        }
+    }
+    if (!options.baseline.empty()) {
+        auto baseline = loadBaseline(options.baseline);
+        if (baseline.empty()) {
+            std::cerr << "[ERROR] No results in baseline " << options.baseline << std::endl;
+            return 1;
+        }
+        for (const auto& m : results) {
+            auto before = baseline.find({m.workload, m.mode});
+            if (before == baseline.end() || before->second.status != "ok" || m.status != "ok") continue;
+            if (before->second.slowdown <= 0 || m.slowdown <= 0) continue;
+            double growth = (m.slowdown / before->second.slowdown - 1) * 100;
+            if (growth > options.threshold) {
+                std::cout << "[REGRESSION] " << m.workload << " (" << m.mode << "): " << std::fixed << std::setprecision(2)
+                          << before->second.slowdown << "x -> " << m.slowdown << "x (" << std::showpos << std::setprecision(0) << growth
+                          << std::noshowpos << "%, threshold " << options.threshold << "%)" << std::endl;
+                problems++;
+            }
+        }
+    }
+    return problems ? 1 : 0;
+}
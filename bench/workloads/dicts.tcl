@@ -0,0 +1,21 @@
+# Dict churn: counters updated in place, keys added and removed
+set scale [expr {[info exists env(TCLDBG_BENCH_SCALE)] ? $env(TCLDBG_BENCH_SCALE) : 1.0}]
+set n [expr {int(50000 * $scale)}]
+
+set counts [dict create]
+for {set i 0} {$i < $n} {incr i} {
+    dict incr counts key[expr {$i % 500}]
+}
+
+proc churn {n} {
+    set cache [dict create]
+    for {set i 0} {$i < $n} {incr i} {
+        dict set cache entry$i [list $i [expr {$i * 2}]]
+        if {$i >= 100} {
+            set cache [dict remove $cache entry[expr {$i - 100}]]
+        }
+    }
+    return [dict size $cache]
+}
+
+puts "dicts: [dict size $counts] [dict get $counts key7] [churn $n]"
@@ -0,0 +1,21 @@
+# List building with lappend, then indexing, sorting and searching it
+set scale [expr {[info exists env(TCLDBG_BENCH_SCALE)] ? $env(TCLDBG_BENCH_SCALE) : 1.0}]
+set n [expr {int(15000 * $scale)}]
+
+set items {}
+for {set i 0} {$i < $n} {incr i} {
+    lappend items [expr {($i * 7919) % 10007}]
+}
+
+proc summarize {values} {
+    set evens {}
+    foreach v $values {
+        if {$v % 2 == 0} {
+            lappend evens $v
+        }
+    }
+    set sorted [lsort -integer $evens]
+    return [list [llength $sorted] [lindex $sorted 0] [lindex $sorted end] [lsearch -exact $values 42]]
+}
+
+puts "lists: [summarize $items]"
@@ -0,0 +1,19 @@
+# Counting loops with arithmetic, at top level and inside a proc
+set scale [expr {[info exists env(TCLDBG_BENCH_SCALE)] ? $env(TCLDBG_BENCH_SCALE) : 1.0}]
+set n [expr {int(100000 * $scale)}]
+
+set total 0
+for {set i 0} {$i < $n} {incr i} {
+    set total [expr {$total + $i % 7}]
+}
+
+proc countdown {n} {
+    set sum 0
+    while {$n > 0} {
+        incr sum [expr {$n & 3}]
+        incr n -1
+    }
+    return $sum
+}
+
+puts "loops: $total [countdown $n]"
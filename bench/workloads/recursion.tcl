@@ -0,0 +1,23 @@
+# Deep and wide recursion: proc calls dominate
+set scale [expr {[info exists env(TCLDBG_BENCH_SCALE)] ? $env(TCLDBG_BENCH_SCALE) : 1.0}]
+set rounds [expr {max(1, int(20 * $scale))}]
+
+proc fib {n} {
+    if {$n < 2} {
+        return $n
+    }
+    return [expr {[fib [expr {$n - 1}]] + [fib [expr {$n - 2}]]}]
+}
+
+proc depth {n} {
+    if {$n == 0} {
+        return 0
+    }
+    return [expr {1 + [depth [expr {$n - 1}]]}]
+}
+
+set result 0
+for {set r 0} {$r < $rounds} {incr r} {
+    set result [expr {$result + [fib 16] + [depth 300]}]
+}
+puts "recursion: $result"
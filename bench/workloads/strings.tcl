@@ -0,0 +1,23 @@
+# String append and rebuilding: long values written over and over
+set scale [expr {[info exists env(TCLDBG_BENCH_SCALE)] ? $env(TCLDBG_BENCH_SCALE) : 1.0}]
+set n [expr {int(8000 * $scale)}]
+
+set log ""
+for {set i 0} {$i < $n} {incr i} {
+    append log "line $i;"
+}
+
+proc assemble {n} {
+    set parts {}
+    set text ""
+    for {set i 0} {$i < $n} {incr i} {
+        set word [format "w%05d" $i]
+        append text [string toupper $word] " "
+        if {$i % 1000 == 0} {
+            lappend parts [string length $text]
+        }
+    }
+    return [list [string length $text] [llength $parts]]
+}
+
+puts "strings: [string length $log] [assemble $n]"
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Regression check for 'until' and 'runto': targets outside procs, inside procs and in a
+# proc called from another must be reached at levels off and line, also when a call
+# runs before them and when the fast-forward starts inside a proc.
+#
+#   sh tests/forward.sh [debugger]       (default ./tcl_debugger_tcl)
+
+debugger=$(cd "$(dirname "${1:-./tcl_debugger_tcl}")" && pwd)/$(basename "${1:-./tcl_debugger_tcl}")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+failures=0
+
+cat > calls.tcl <<'EOF'
+proc inner {n} {
+    set t 0
+    for {set i 0} {$i < $n} {incr i} { incr t }
+    return $t
+}
+proc outer {n} {
+    set r [inner $n]
+    set q [expr {$r + 1}]
+    return $q
+}
+set a 1
+set b 2
+set x [inner 1000]
+set y [outer 3]
+puts "y=$y"
+EOF
+
+# expect <name> <pattern> <level> <commands...>
+expect() {
+    name=$1 pattern=$2 level=$3
+    shift 3
+    printf '%s\n' "$@" > commands
+    output=$(timeout 20 "$debugger" --no-color --quiet --commands commands --script calls.tcl --instrument "$level" 2>&1)
+    if printf '%s\n' "$output" | grep -q "$pattern"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        printf '%s\n' "$output" | tail -5 | sed 's/^/     /'
+        failures=$((failures + 1))
+    fi
+}
+
+for level in off line; do
+    expect "until the first line, level $level" 'Reached calls.tcl:11' "$level" 'until 11' continue
+    expect "until a line before any call, level $level" 'Reached calls.tcl:12' "$level" 'until 12' continue
+    expect "until a line after a call, level $level" 'Reached calls.tcl:14' "$level" 'until 14' continue
+    expect "until the last line, level $level" 'Reached calls.tcl:15' "$level" 'until 15' continue
+    expect "until a line in a proc, level $level" 'Reached calls.tcl:3' "$level" 'until 3' continue
+    expect "until a line after a nested call, level $level" 'Reached calls.tcl:8' "$level" 'until 8' continue
+    expect "until outside procs from inside one, level $level" 'Reached calls.tcl:14' "$level" 'until 3' 'until 14' continue
+    expect "until in another proc from inside one, level $level" 'Reached calls.tcl:8' "$level" 'until 3' 'until 8' continue
+    expect "runto a proc, level $level" 'Reached inner at calls.tcl:2' "$level" 'runto inner' continue
+    expect "runto a proc called later, level $level" 'Reached outer at calls.tcl:7' "$level" 'runto outer' continue
+    expect "runto from inside a proc, level $level" 'Reached outer at calls.tcl:7' "$level" 'until 3' 'runto outer' continue
+done
+
+[ "$failures" -eq 0 ] && echo "all fast-forward checks passed" || echo "$failures fast-forward checks failed"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Regression check for 'limit commands': a loop of compiled commands at the top level
+# must use up its budget at every instrument level, with and without the sampling
+# profiler or shimmer sampling, which share Tcl's command limit with it, and a budget
+# exactly the size of the script must let it finish.
+#
+#   sh tests/limits.sh [debugger]        (default ./tcl_debugger_tcl)
+
+debugger=$(cd "$(dirname "${1:-./tcl_debugger_tcl}")" && pwd)/$(basename "${1:-./tcl_debugger_tcl}")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+failures=0
+
+printf 'set i 0\nwhile {1} {incr i}\n' > loop.tcl
+printf 'set a 1\nset b 2\nset c 3\n' > three.tcl
+
+# expect <name> <pattern> <script> <level> <commands...>
+expect() {
+    name=$1 pattern=$2 script=$3 level=$4
+    shift 4
+    printf '%s\n' "$@" > commands
+    output=$(timeout 20 "$debugger" --no-color --quiet --commands commands --script "$script" --instrument "$level" 2>&1)
+    if printf '%s\n' "$output" | grep -q "$pattern"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        printf '%s\n' "$output" | tail -5 | sed 's/^/     /'
+        failures=$((failures + 1))
+    fi
+}
+
+for level in off proc command line var; do
+    expect "top-level loop, level $level" 'used its budget of 1000 commands' loop.tcl "$level" 'limit commands 1000' run
+done
+expect "top-level loop, sampling" 'used its budget of 1000 commands' loop.tcl line 'limit commands 1000' 'profile start' run
+expect "top-level loop, shimmer sampling" 'used its budget of 1000 commands' loop.tcl off 'limit commands 1000' 'shimmer on every 2' run
+expect "budget of the script's size, level off" 'DONE' three.tcl off 'limit commands 3' run
+expect "budget of the script's size, shimmer sampling" 'DONE' three.tcl off 'limit commands 3' 'shimmer on every 1' run
+expect "budget of the script's size, level line" 'DONE' three.tcl line 'limit commands 3' run
+expect "budget one short, level line" 'used its budget of 2 commands at line 3' three.tcl line 'limit commands 2' run
+
+[ "$failures" -eq 0 ] && echo "all limit checks passed" || echo "$failures limit checks failed"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,58 @@
+#!/bin/sh
+# Regression check for 'next' and 'finish': calls stepped over run untraced, yet a
+# breakpoint in a proc they call still stops the step, and both pause where they should.
+#
+#   sh tests/step.sh [debugger]          (default ./tcl_debugger_tcl)
+
+debugger=$(cd "$(dirname "${1:-./tcl_debugger_tcl}")" && pwd)/$(basename "${1:-./tcl_debugger_tcl}")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+cd "$work" || exit 1
+failures=0
+
+cat > calls.tcl <<'EOF'
+proc work {n} {
+    set s 0
+    for {set i 0} {$i < $n} {incr i} { incr s $i }
+    return $s
+}
+proc marked {} {
+    set m 1
+    return $m
+}
+proc both {} {
+    work 10
+    marked
+    return 2
+}
+set a 1
+set b [work 1000]
+set c 3
+set d [both]
+set e 5
+EOF
+
+# expect <name> <pattern> <commands...>
+expect() {
+    name=$1 pattern=$2
+    shift 2
+    printf '%s\n' "$@" > commands
+    output=$(timeout 20 "$debugger" --no-color --quiet --commands commands --script calls.tcl --instrument line 2>&1)
+    if printf '%s\n' "$output" | grep -q "$pattern"; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        printf '%s\n' "$output" | tail -5 | sed 's/^/     /'
+        failures=$((failures + 1))
+    fi
+}
+
+expect "next over a call" 'At line 17: set c 3' 'break 16' run next continue
+expect "next over a call into a breakpoint" 'Hit at calls.tcl:7' 'break 18' 'break 7' run next continue continue
+expect "next inside a proc" 'At line 12: marked' 'break 11' run next continue
+expect "next out of a proc" 'At line 18: set d' 'break 13' run next next continue
+expect "finish" 'At line 18: set d' 'break 11' run finish continue
+expect "finish into a breakpoint" 'Hit at calls.tcl:7' 'break 11' 'break 7' run finish continue continue
+
+[ "$failures" -eq 0 ] && echo "all step checks passed" || echo "$failures step checks failed"
+[ "$failures" -eq 0 ]